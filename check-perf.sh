@@ -0,0 +1,105 @@
+#!/bin/bash
+# check-perf: correctness and throughput regression gate (make check-perf).
+#
+# test-csim proves csim agrees with csim-ref on the bundled traces, but
+# nothing stops a change from making the simulator several times slower.
+# This harness runs a pinned set of (trace, config) pairs and fails if
+# either the hits/misses/evictions tuples drift from the stored golden
+# results (check-perf.golden, committed: simulation output is
+# deterministic) or the measured accesses/second drops more than
+# CHECK_PERF_TOL below the stored baseline (check-perf.baseline, machine
+# specific: created on first run, never committed, delete it to
+# rebaseline after a hardware or toolchain change).
+#
+# Stats come from the .csim_results file print_summary() already writes
+# (one "hits misses evictions" line per configuration). Throughput is
+# measured on an amplified copy of the trace so each run lasts long
+# enough to time: CHECK_PERF_REPS repetitions per pair, and the median
+# rep is kept, which discards outliers from scheduler noise and cold
+# page caches in one step.
+
+set -u
+
+CSIM=./csim
+GOLDEN=check-perf.golden
+BASELINE=check-perf.baseline
+REPS=${CHECK_PERF_REPS:-5}
+TOL=${CHECK_PERF_TOL:-0.25} # fail below (1 - TOL) * baseline
+AMP=${CHECK_PERF_AMP:-40}   # trace copies concatenated for the timed runs
+
+# The pinned pairs, one per hot path worth gating: the batch LRU kernel,
+# the direct-mapped fast path, a specialized policy kernel, the wide-set
+# hash-index path, and a multi-configuration sweep.
+IDS=(lru-e2 direct srrip-e8 wide-e64 multi)
+TRACES=(traces/trace5 traces/trace5 traces/trace5 traces/trace5 traces/trace5)
+CONFIGS=("-s 4 -E 2 -b 4"
+         "-s 1 -E 1 -b 4"
+         "-s 4 -E 8 -b 4 -p srrip"
+         "-s 2 -E 64 -b 4"
+         "-s 2 -E 1 -b 4 -s 4 -E 2 -b 4 -s 6 -E 4 -b 5")
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+fail=0
+
+# Pass 1: golden stats, one plain run per pair on the real trace.
+for i in "${!IDS[@]}"; do
+    if ! $CSIM ${CONFIGS[$i]} -t "${TRACES[$i]}" > /dev/null; then
+        echo "check-perf: FAIL ${IDS[$i]}: csim exited nonzero"
+        exit 1
+    fi
+    while read -r line; do
+        echo "${IDS[$i]} $line"
+    done < .csim_results >> "$work/stats"
+done
+if [ ! -f "$GOLDEN" ]; then
+    cp "$work/stats" "$GOLDEN"
+    echo "check-perf: wrote $GOLDEN (first run; commit it)"
+elif ! diff "$GOLDEN" "$work/stats" > "$work/stats.diff"; then
+    echo "check-perf: FAIL stats differ from $GOLDEN:"
+    cat "$work/stats.diff"
+    fail=1
+else
+    echo "check-perf: stats match $GOLDEN (${#IDS[@]} pairs)"
+fi
+
+# Pass 2: throughput, $REPS timed runs per pair on the amplified trace.
+for i in "${!IDS[@]}"; do
+    trace=${TRACES[$i]}
+    amp="$work/$(basename "$trace").amp"
+    if [ ! -f "$amp" ]; then
+        for _ in $(seq "$AMP"); do cat "$trace"; done > "$amp"
+    fi
+    : > "$work/rates"
+    for _ in $(seq "$REPS"); do
+        t0=$(date +%s%N)
+        $CSIM ${CONFIGS[$i]} -t "$amp" > /dev/null || exit 1
+        t1=$(date +%s%N)
+        # accesses/second from the tuples csim just wrote and the wall time
+        awk -v ns=$((t1 - t0)) \
+            '{acc += $1 + $2} END {printf "%.0f\n", acc * 1e9 / ns}' \
+            .csim_results >> "$work/rates"
+    done
+    median=$(sort -n "$work/rates" | sed -n "$(((REPS + 1) / 2))p")
+    base=$(awk -v id="${IDS[$i]}" '$1 == id {print $2}' "$BASELINE" 2>/dev/null)
+    if [ -z "${base:-}" ]; then
+        echo "${IDS[$i]} $median" >> "$BASELINE"
+        printf "check-perf: %-10s %12s acc/s (new baseline)\n" \
+               "${IDS[$i]}" "$median"
+        continue
+    fi
+    verdict=$(awk -v cur="$median" -v base="$base" -v tol="$TOL" 'BEGIN {
+        delta = (cur - base) * 100.0 / base;
+        printf "%+.1f%% %s", delta, cur < base * (1 - tol) ? "FAIL" : "ok";
+    }')
+    printf "check-perf: %-10s %12s acc/s vs %12s baseline  %s\n" \
+           "${IDS[$i]}" "$median" "$base" "$verdict"
+    case $verdict in *FAIL) fail=1 ;; esac
+done
+
+if [ "$fail" -ne 0 ]; then
+    echo "check-perf: FAILED"
+    exit 1
+fi
+echo "check-perf: OK"